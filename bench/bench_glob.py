@@ -0,0 +1,50 @@
+#!/usr/bin/python3
+
+# Times native glob expansion over a large directory against the `ls dir | grep pattern`
+# workaround, and shows the effect of reusing a cached listing on later lines.
+
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+ENGINE = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", "engine.out"))
+FOLDER = "bench_glob.folder"
+SCRIPT = "bench_glob.in"
+ENTRIES = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+LINES = 20
+RUNS = 3
+
+
+def best_time(lines):
+    with open(SCRIPT, "w") as script:
+        script.write("\n".join(lines) + "\n")
+    best = None
+    for _ in range(RUNS):
+        start = time.perf_counter()
+        subprocess.run([ENGINE, SCRIPT], stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+shutil.rmtree(FOLDER, ignore_errors=True)
+os.mkdir(FOLDER)
+for i in range(ENTRIES):
+    open(os.path.join(FOLDER, "file%06d" % i), "w").close()
+
+cases = [("glob, 1 line", ["echo " + FOLDER + "/file*99"]),
+         ("glob, %d lines (cached listing)" % LINES, ["echo " + FOLDER + "/file*99"] * LINES),
+         ("glob, %d lines (touch, then glob)" % LINES,
+          [line for i in range(LINES // 2)
+           for line in ("touch " + FOLDER + "/extra%d" % i, "echo " + FOLDER + "/file*99")]),
+         ("ls | grep, 1 line", ["ls " + FOLDER + " | grep 99"]),
+         ("ls | grep, %d lines" % LINES, ["ls " + FOLDER + " | grep 99"] * LINES)]
+
+print("%d entries, best of %d runs" % (ENTRIES, RUNS))
+for name, lines in cases:
+    print("%-40s %8.1f ms" % (name, best_time(lines) * 1000))
+
+shutil.rmtree(FOLDER)
+os.remove(SCRIPT)
@@ -0,0 +1,44 @@
+#!/usr/bin/python3
+
+# Measures GB/s through a multi-stage pipeline of external processes for different
+# pipe capacities (-p) and CPU placements (-c) of the engine.
+
+import os
+import subprocess
+import sys
+import time
+
+ENGINE = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", "engine.out"))
+SCRIPT = "bench_pipe_tuning.in"
+BYTES = int(sys.argv[1]) if len(sys.argv) > 1 else 4 * 1024 ** 3
+RUNS = 3
+
+PIPELINE = "/usr/bin/head -c %d /dev/zero | /usr/bin/cat | /usr/bin/cat | /usr/bin/cat | /usr/bin/wc -c" % BYTES
+
+allowed = sorted(os.sched_getaffinity(0))
+placements = [("unpinned", None), ("all on cpu %d" % allowed[0], str(allowed[0]))]
+if len(allowed) > 1:
+    placements.append(("one cpu per stage", ",".join(str(cpu) for cpu in allowed)))
+    placements.append(("siblings adjacent", "siblings"))
+
+
+def best_time(options):
+    best = None
+    for _ in range(RUNS):
+        start = time.perf_counter()
+        subprocess.run([ENGINE] + options + [SCRIPT], stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+with open(SCRIPT, "w") as script:
+    script.write(PIPELINE + "\n")
+
+print("%.1f GB through 5 stages, best of %d runs" % (BYTES / 1e9, RUNS))
+for pipe_size in ["64K", "256K", "1M"]:
+    for name, cpus in placements:
+        options = ["-p", pipe_size] + (["-c", cpus] if cpus is not None else [])
+        print("pipe %-5s %-20s %6.2f GB/s" % (pipe_size, name, BYTES / 1e9 / best_time(options)))
+
+os.remove(SCRIPT)
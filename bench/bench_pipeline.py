@@ -0,0 +1,50 @@
+#!/usr/bin/python3
+
+# Compares pipelines whose filters run as builtin threads against the same pipelines
+# forced through external processes (a full path always bypasses the builtins).
+
+import os
+import subprocess
+import sys
+import time
+
+ENGINE = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", "engine.out"))
+DATA = "bench_pipeline.data"
+SCRIPT = "bench_pipeline.in"
+LINES = int(sys.argv[1]) if len(sys.argv) > 1 else 2000000
+RUNS = 5
+
+pipelines = [("rev | grep 99 | wc -l",
+              "/usr/bin/rev | /usr/bin/grep 99 | /usr/bin/wc -l"),
+             ("rev | rev | rev | tail -n 1",
+              "/usr/bin/rev | /usr/bin/rev | /usr/bin/rev | /usr/bin/tail -n 1"),
+             ("grep -v 7 | head -n 1000000 | wc -c",
+              "/usr/bin/grep -v 7 | /usr/bin/head -n 1000000 | /usr/bin/wc -c")]
+
+
+def best_time(line):
+    with open(SCRIPT, "w") as script:
+        script.write(line + "\n")
+    best = None
+    for _ in range(RUNS):
+        start = time.perf_counter()
+        subprocess.run([ENGINE, SCRIPT], stdout=subprocess.DEVNULL, check=True)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+with open(DATA, "w") as data:
+    for i in range(LINES):
+        data.write("%d the quick brown fox %d\n" % (i, i * 7))
+size_mb = os.path.getsize(DATA) / 1e6
+
+print("%.1f MB input, best of %d runs" % (size_mb, RUNS))
+for threaded, processes in pipelines:
+    t_threaded = best_time("cat " + DATA + " | " + threaded)
+    t_processes = best_time("cat " + DATA + " | " + processes)
+    print("%-40s threads %7.1f MB/s   processes %7.1f MB/s   (%.2fx)"
+          % (threaded, size_mb / t_threaded, size_mb / t_processes, t_processes / t_threaded))
+
+os.remove(DATA)
+os.remove(SCRIPT)
@@ -1,9 +1,16 @@
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include <sys/wait.h>
 #include "parser.h"
+#include "filters.h"
+#include "expand.h"
+#include "tuning.h"
 
 typedef struct Node {
     char *key;
@@ -27,24 +34,37 @@ int assign_variable(Node **head, const char *var_name, char *params[]);
 
 int handle_redirect(char *params[], int num_tokens);
 
-int handle_pipe(char *params[], char **output);
+int handle_pipe(char *params[], int num_tokens, int output_fd, char **output);
 
 int handle_pipe2redirect(char *params[], int num_tokens);
 
 int handle_pipe2var(Node **head, const char* var_name, char *params[], int num_tokens);
 
+int write_all(int fd, const char *buffer, size_t len);
+
+int open_herestring(const char *data);
+
 int read_line(int infile, char *buffer, int maxlen);
 
 
 int main(const int argc, char *argv[]) {
     Node *head = NULL;
 
-    if (argc != 2) {
-        printf("Usage: %s <input file>\n", argv[0]);
+    // -p sets the pipe capacity and -c the CPUs pipeline stages are pinned to, for the whole script
+    const char *pipe_size = NULL, *cpus = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:")) != -1) {
+        if (opt == 'p') pipe_size = optarg;
+        else if (opt == 'c') cpus = optarg;
+        else break;
+    }
+
+    if (opt != -1 || optind != argc - 1 || tuning_configure(pipe_size, cpus) < 0) {
+        printf("Usage: %s [-p pipe_size] [-c cpu_list|siblings] <input file>\n", argv[0]);
         return -1;
     }
 
-    const int infile = open(argv[1], O_RDONLY);
+    const int infile = open(argv[optind], O_RDONLY);
     if (infile < 0) {
         perror("Error opening input file");
         return -2;
@@ -68,38 +88,103 @@ int main(const int argc, char *argv[]) {
 
         // Parse token list
         // * Organize tokens into command parameters
-        char *command = tokens[0]->value;
-        char *params[numtokens + 1];
+        // * A here-string and its word are pulled out of the parameters
+        // * Wildcard words are replaced by the sorted paths they match, or kept as-is if none do
+        char **params = malloc((numtokens + 1) * sizeof(char *));
+        char **globbed = NULL;
+        int numglobbed = 0;
+        char *herestring = NULL;
+        int numparams = 0;
+        int valid = TRUE;
+
+        if (params == NULL) {
+            perror("Failed to allocate command parameters");
+            return -5;
+        }
+        glob_begin_line();
+        tuning_begin_line(variable_lookup(&head, "TSH_PIPESIZE"), variable_lookup(&head, "TSH_CPUS"));
 
         int assign = -1, pipe = -1, redir = -1;
         for (int i = 0; i < numtokens; i++) {
             assign = tokens[i]->type == TOKEN_ASSIGN ? 1 : assign;
             pipe = tokens[i]->type == TOKEN_PIPE ? 1 : pipe;
             redir = tokens[i]->type == TOKEN_REDIR ? 1 : redir;
+            if (tokens[i]->type == TOKEN_HERESTR) {
+                if (pipe > 0 || i + 1 >= numtokens ||
+                    (tokens[i + 1]->type != TOKEN_STRING && tokens[i + 1]->type != TOKEN_VAR &&
+                     tokens[i + 1]->type != TOKEN_GLOB)) {
+                    fprintf(stderr, "Here-string needs a word and must feed the first command\n");
+                    valid = FALSE;
+                    break;
+                }
+                i++;
+                herestring = tokens[i]->type == TOKEN_VAR ? variable_lookup(&head, tokens[i]->value) : tokens[i]->value;
+                if (herestring == NULL) {
+                    perror("Unknown variable");
+                    return -4;
+                }
+                continue;
+            }
             if (tokens[i]->type == TOKEN_VAR) {
                 char *expanded = variable_lookup(&head, tokens[i]->value);
                 if (expanded == NULL) {
                     perror("Unknown variable");
                     return -4;
                 } else {
-                    params[i] = expanded;
+                    params[numparams++] = expanded;
+                    continue;
+                }
+            }
+            if (tokens[i]->type == TOKEN_GLOB) {
+                const int first = numglobbed;
+                const int found = glob_expand(tokens[i]->value, &globbed, &numglobbed);
+                // A redirect writes to a single file, so its target may only name one
+                if (i > 0 && tokens[i - 1]->type == TOKEN_REDIR && found > 1) {
+                    fprintf(stderr, "Ambiguous redirect: %s\n", tokens[i]->value);
+                    valid = FALSE;
+                    break;
+                }
+                if (found > 0) {
+                    char **more = realloc(params, (numtokens + numglobbed + 1) * sizeof(char *));
+                    if (more == NULL) {
+                        perror("Failed to grow command parameters");
+                        return -5;
+                    }
+                    params = more;
+                    for (int g = first; g < numglobbed; g++) params[numparams++] = globbed[g];
                     continue;
                 }
             }
-            params[i] = tokens[i]->value;
+            params[numparams++] = tokens[i]->value;
+        }
+        params[numparams] = NULL;
+        char *command = params[0];
+        valid = valid && numparams > 0;
+
+        // Feed the here-string through the engine's stdin so the first child inherits it
+        int saved_stdin = -1;
+        if (valid && herestring != NULL) {
+            int data_fd = open_herestring(herestring);
+            saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+            if (data_fd < 0 || dup2(data_fd, STDIN_FILENO) < 0) {
+                perror("Failed to attach here-string to stdin");
+                valid = FALSE;
+            }
+            if (data_fd >= 0) close(data_fd);
         }
-        params[numtokens] = NULL;
 
-        if (assign > 0 && pipe > 0) {
-            handle_pipe2var(&head, command, params, numtokens);
+        if (!valid) {
+            // Nothing to run
+        } else if (assign > 0 && pipe > 0) {
+            handle_pipe2var(&head, command, params, numparams);
         } else if (assign > 0) {
             assign_variable(&head, command, params);
         } else if (pipe > 0 && redir > 0) {
-            handle_pipe2redirect(params, numtokens);
+            handle_pipe2redirect(params, numparams);
         } else if (pipe > 0) {
-            handle_pipe(params, NULL);
+            handle_pipe(params, numparams, STDOUT_FILENO, NULL);
         } else if (redir > 0) {
-            handle_redirect(params, numtokens);
+            handle_redirect(params, numparams);
         } else {
             normalize_executable(&command);
             if (fork() != 0) {
@@ -112,6 +197,20 @@ int main(const int argc, char *argv[]) {
             }
         }
 
+        if (herestring != NULL) {
+            if (saved_stdin >= 0) {
+                dup2(saved_stdin, STDIN_FILENO);
+                close(saved_stdin);
+            } else {
+                close(STDIN_FILENO);
+            }
+        }
+
+        // Free parameters and glob matches
+        for (int g = 0; g < numglobbed; g++) free(globbed[g]);
+        free(globbed);
+        free(params);
+
         // Free tokens vector
         for (int ii = 0; ii < numtokens; ii++) {
             free(tokens[ii]->value);
@@ -122,6 +221,8 @@ int main(const int argc, char *argv[]) {
 
     close(infile);
     destroy(&head);
+    glob_cache_clear();
+    tuning_clear();
 
     // Remember to deallocate anything left which was allocated dynamically
     // (i.e., using malloc, realloc, strdup, etc.)
@@ -274,7 +375,7 @@ int assign_variable(Node **head, const char *var_name, char *params[]) {
     normalize_executable(&sub_command);
 
     int pipe_fd[2];
-    if (pipe(pipe_fd) == -1) {
+    if (tuned_pipe(pipe_fd) == -1) {
         perror("Pipe creation failed");
         exit(-1);
     }
@@ -298,22 +399,44 @@ int assign_variable(Node **head, const char *var_name, char *params[]) {
         }
     } else {
         close(pipe_fd[1]);
-        wait(NULL);
-        char buffer[4096];
-        ssize_t bytes = read(pipe_fd[0], buffer, sizeof(buffer) - 1);
-        if (bytes < 0) {
+
+        // Drain the pipe before waiting, or a child with more output than the pipe holds never exits
+        ssize_t bytes_read = 0;
+        size_t total_bytes = 0;
+        size_t buffer_size = 4096;
+        char *buffer = malloc(buffer_size);
+        if (!buffer) {
+            perror("Failed to allocate buffer");
+            exit(-1);
+        }
+
+        while ((bytes_read = read(pipe_fd[0], buffer + total_bytes, buffer_size - total_bytes - 1)) > 0) {
+            total_bytes += bytes_read;
+            if (total_bytes >= buffer_size - 1) {
+                buffer_size *= 2;
+                char *new_buffer = realloc(buffer, buffer_size);
+                if (!new_buffer) {
+                    perror("Failed to reallocate buffer");
+                    free(buffer);
+                    exit(-1);
+                }
+                buffer = new_buffer;
+            }
+        }
+
+        if (bytes_read < 0) {
             perror("Sub command read failed");
+            free(buffer);
             close(pipe_fd[0]);
             exit(-1);
         }
-        buffer[bytes] = '\0';
+        buffer[total_bytes] = '\0';
+        close(pipe_fd[0]);
+        waitpid(pid, NULL, 0);
 
-        char *output = strdup(buffer);
-        if (output != NULL) {
-            output[strcspn(output, "\n")] = '\0';
-            update_variable(head, var_name, output);
-            free(output);
-        }
+        buffer[strcspn(buffer, "\n")] = '\0';
+        update_variable(head, var_name, buffer);
+        free(buffer);
     }
     return 0;
 }
@@ -365,219 +488,236 @@ int handle_redirect(char *params[], const int num_tokens) {
     return 0;
 }
 
-int handle_pipe(char *params[], char **output) {
-    int src_num_params = 0;
-    for (int i = 0; params[i++] != NULL; src_num_params++) {}
-
-    char *sub_params_src[src_num_params + 1];
-    for (int i = 0; params[i] != NULL; i++) {
-        sub_params_src[i] = params[i];
+int handle_pipe(char *params[], const int num_tokens, const int output_fd, char **output) {
+    // Stages are separated by the NULL left in place of each pipe token
+    int num_stages = 1;
+    for (int i = 0; i < num_tokens; i++) {
+        if (params[i] == NULL) num_stages++;
     }
-    sub_params_src[src_num_params] = NULL;
-    char *sub_command_src = sub_params_src[0];
-    normalize_executable(&sub_command_src);
 
-    int dest_num_params = 0;
-    for (int i = src_num_params + 1; params[i++] != NULL; dest_num_params++) {}
+    char **stage_params[num_stages];
+    char *commands[num_stages];
+    int builtin[num_stages];
+    filter_stage_t filters[num_stages];
+    stage_params[0] = params;
+    for (int i = 0, stage = 1; i < num_tokens; i++) {
+        if (params[i] == NULL) stage_params[stage++] = &params[i + 1];
+    }
 
-    char *sub_params_dest[dest_num_params + 1];
-    for(int i = 0; params[src_num_params + 1 + i] != NULL; i++) {
-        sub_params_dest[i] = params[src_num_params + 1 + i];
+    for (int stage = 0; stage < num_stages; stage++) {
+        if (stage_params[stage][0] == NULL) {
+            fprintf(stderr, "Missing command in pipeline\n");
+            return -1;
+        }
+        builtin[stage] = filter_parse(stage_params[stage], &filters[stage].filter);
+        commands[stage] = stage_params[stage][0];
+        if (!builtin[stage]) normalize_executable(&commands[stage]);
     }
-    sub_params_dest[dest_num_params] = NULL;
-    char *sub_command_dest = sub_params_dest[0];
-    normalize_executable(&sub_command_dest);
 
     int output_pipe[2];
-    int pipefd[2];
-    if (pipe(pipefd) == -1 || pipe(output_pipe) == -1) {
+    if (output != NULL && tuned_pipe(output_pipe) == -1) {
         perror("Failed to create pipe");
         exit(-1);
     }
 
-    pid_t pid1 = fork();
-    if (pid1 == -1) {
-        perror("Failed forking first child process");
-        exit(-1);
-    }
-
-    if (pid1 == 0) {
-        close(pipefd[0]);
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[1]);
-        close(output_pipe[0]);
-        close(output_pipe[1]);
+    // Neighbouring builtin stages share a ring; a real pipe is only needed next to a process.
+    // Every descriptor is close-on-exec, so a child only keeps what it dup2's onto stdin/stdout.
+    pid_t pids[num_stages];
+    pthread_t threads[num_stages];
+    ring_t *rings[num_stages];
+    stream_t in = {STDIN_FILENO, FALSE, NULL};
+    for (int stage = 0; stage < num_stages; stage++) {
+        stream_t out = {-1, FALSE, NULL};
+        stream_t next_in = {-1, FALSE, NULL};
+        rings[stage] = NULL;
+
+        if (stage == num_stages - 1) {
+            out.fd = output != NULL ? output_pipe[1] : output_fd;
+            out.owned = output != NULL;
+        } else if (builtin[stage] && builtin[stage + 1]) {
+            rings[stage] = ring_create(tuning_ring_capacity());
+            if (rings[stage] == NULL) {
+                perror("Failed to allocate ring buffer");
+                exit(-1);
+            }
+            out.ring = next_in.ring = rings[stage];
+        } else {
+            int pipefd[2];
+            if (tuned_pipe(pipefd) == -1) {
+                perror("Failed to create pipe");
+                exit(-1);
+            }
+            next_in.fd = pipefd[0];
+            next_in.owned = TRUE;
+            out.fd = pipefd[1];
+            out.owned = TRUE;
+        }
 
-        execve(sub_command_src, sub_params_src, NULL);
-        perror("execve failed running source");
-        exit(-1);
-    }
+        if (builtin[stage]) {
+            filters[stage].in = in;
+            filters[stage].out = out;
+            filters[stage].cpu = tuning_stage_cpu(stage);
+            if (pthread_create(&threads[stage], NULL, filter_thread, &filters[stage]) != 0) {
+                perror("Failed to start builtin stage");
+                exit(-1);
+            }
+        } else {
+            const int cpu = tuning_stage_cpu(stage);
+            pids[stage] = fork();
+            if (pids[stage] == -1) {
+                perror("Failed forking pipeline stage");
+                exit(-1);
+            }
 
-    pid_t pid2 = fork();
-    if (pid2 == -1) {
-        perror("fork");
-        exit(-1);
-    }
+            if (pids[stage] == 0) {
+                if (in.fd != STDIN_FILENO) dup2(in.fd, STDIN_FILENO);
+                if (out.fd != STDOUT_FILENO) dup2(out.fd, STDOUT_FILENO);
+                tuning_pin(cpu);
 
-    if (pid2 == 0) {
-        close(pipefd[1]);
-        dup2(pipefd[0], STDIN_FILENO);
-        close(pipefd[0]);
-        close(output_pipe[0]);
-        dup2(output_pipe[1], STDOUT_FILENO);
-        close(output_pipe[1]);
+                execve(commands[stage], stage_params[stage], NULL);
+                perror("execve failed running pipeline stage");
+                exit(-1);
+            }
 
-        execve(sub_command_dest, sub_params_dest, NULL);
-        perror("execve failed running destination");
-        exit(-1);
+            stream_close_read(&in);
+            stream_close_write(&out);
+        }
+        in = next_in;
     }
 
-    close(pipefd[0]);
-    close(pipefd[1]);
-    close(output_pipe[1]);
-
-    ssize_t bytes_read = 0;
-    size_t total_bytes = 0;
-    size_t buffer_size = 4096;
-    char *buffer = malloc(buffer_size);
-    if (!buffer) {
-        perror("Failed to allocate buffer");
-        exit(-1);
-    }
+    if (output != NULL) {
+        ssize_t bytes_read = 0;
+        size_t total_bytes = 0;
+        size_t buffer_size = 4096;
+        char *buffer = malloc(buffer_size);
+        if (!buffer) {
+            perror("Failed to allocate buffer");
+            exit(-1);
+        }
 
-    while ((bytes_read = read(output_pipe[0], buffer + total_bytes, buffer_size - total_bytes - 1)) > 0) {
-        total_bytes += bytes_read;
-        if (total_bytes >= buffer_size - 1) {
-            buffer_size *= 2;
-            char *new_buffer = realloc(buffer, buffer_size);
-            if (!new_buffer) {
-                perror("Failed to reallocate buffer");
-                free(buffer);
-                exit(-1);
+        while ((bytes_read = read(output_pipe[0], buffer + total_bytes, buffer_size - total_bytes - 1)) > 0) {
+            total_bytes += bytes_read;
+            if (total_bytes >= buffer_size - 1) {
+                buffer_size *= 2;
+                char *new_buffer = realloc(buffer, buffer_size);
+                if (!new_buffer) {
+                    perror("Failed to reallocate buffer");
+                    free(buffer);
+                    exit(-1);
+                }
+                buffer = new_buffer;
             }
-            buffer = new_buffer;
         }
-    }
 
-    if (bytes_read == -1) {
-        perror("Read from second command failed");
-        free(buffer);
-        exit(-1);
-    }
-
-    buffer[total_bytes] = '\0';
+        if (bytes_read == -1) {
+            perror("Read from last command failed");
+            free(buffer);
+            exit(-1);
+        }
 
-    if (output == NULL) {
-        write(STDOUT_FILENO, buffer, strlen(buffer));
-        free(buffer);
-    } else {
+        buffer[total_bytes] = '\0';
         buffer[strlen(buffer) > 0 && buffer[strlen(buffer) - 1] == '\n' ? strlen(buffer) - 1 : strlen(buffer)] = '\0';
         *output = buffer;
-    }
 
-    close(output_pipe[0]);
+        close(output_pipe[0]);
+    }
 
-    waitpid(pid1, NULL, 0);
-    waitpid(pid2, NULL, 0);
+    for (int stage = 0; stage < num_stages; stage++) {
+        if (builtin[stage]) {
+            pthread_join(threads[stage], NULL);
+            // EPIPE only means a later stage stopped reading early, as `head` does
+            if (filters[stage].status != 0 && filters[stage].status != EPIPE) {
+                fprintf(stderr, "%s: %s\n", stage_params[stage][0], strerror(filters[stage].status));
+            }
+        } else {
+            waitpid(pids[stage], NULL, 0);
+        }
+    }
+    for (int stage = 0; stage < num_stages; stage++) {
+        ring_destroy(rings[stage]);
+    }
 
     return 0;
 }
 
 int handle_pipe2redirect(char *params[], const int num_tokens) {
+    // The redirect token left a NULL in front of the file name, which also ends the last stage
     char *output_file = params[num_tokens - 1];
-    int src_num_params = 0;
-    for (int i = 0; params[i++] != NULL; src_num_params++) {}
 
-    char *sub_params_src[src_num_params + 1];
-    for (int i = 0; params[i] != NULL; i++) {
-        sub_params_src[i] = params[i];
+    int fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("Failed to open output file");
+        return -1;
     }
-    sub_params_src[src_num_params] = NULL;
-    char *sub_command_src = sub_params_src[0];
-    normalize_executable(&sub_command_src);
 
-    int dest_num_params = 0;
-    for (int i = src_num_params + 1; params[i++] != NULL; dest_num_params++) {}
+    const int status = handle_pipe(params, num_tokens - 2, fd, NULL);
+    close(fd);
+    return status;
+}
 
-    char *sub_params_dest[dest_num_params + 1];
-    for(int i = 0; params[src_num_params + 1 + i] != NULL; i++) {
-        sub_params_dest[i] = params[src_num_params + 1 + i];
+int handle_pipe2var(Node **head, const char* var_name, char *params[], const int num_tokens) {
+    char *sub_params[num_tokens - 1];
+    for(int i = 2; i < num_tokens; i++) {
+        sub_params[i - 2] = params[i];
     }
-    sub_params_dest[dest_num_params] = NULL;
-    char *sub_command_dest = sub_params_dest[0];
-    normalize_executable(&sub_command_dest);
+    sub_params[num_tokens - 2] = NULL;
 
-    int pipe_fd[2];
-    if (pipe(pipe_fd) == -1) {
-        perror("Failed to create pipe");
-        exit(-1);
-    }
+    char *command_output = NULL;
+    if (handle_pipe(sub_params, num_tokens - 2, STDOUT_FILENO, &command_output) < 0) return -1;
 
-    pid_t pid1 = fork();
-    if (pid1 < 0) {
-        perror("Failed forking on first command");
-        exit(-1);
-    }
+    update_variable(head, var_name, command_output);
 
-    if (pid1 == 0) {
-        dup2(pipe_fd[1], STDOUT_FILENO);
-        close(pipe_fd[0]);
-        close(pipe_fd[1]);
+    free(command_output);
+    return 0;
+}
 
-        if (execve(sub_command_src, sub_params_src, NULL) == -1) {
-            perror("Failed to execute first command while handling pipe");
-            exit(-1);
-        }
+int write_all(const int fd, const char *buffer, size_t len) {
+    while (len > 0) {
+        const ssize_t written = write(fd, buffer, len);
+        if (written < 0) return -1;
+        buffer += written;
+        len -= written;
     }
+    return 0;
+}
 
-    pid_t pid2 = fork();
-    if (pid2 < 0) {
-        perror("Failed forking on second command");
-        exit(-1);
+int open_herestring(const char *data) {
+    const size_t len = strlen(data);
+
+    // Small payloads fit in a pipe's buffer, so it can be filled before any reader exists
+    int pipe_fd[2];
+    if (tuned_pipe(pipe_fd) == -1) {
+        perror("Failed to create here-string pipe");
+        return -1;
     }
 
-    if (pid2 == 0) {
-        int output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (output_fd < 0) {
-            perror("Failed to open output file");
-            exit(EXIT_FAILURE);
+    const int capacity = fcntl(pipe_fd[1], F_GETPIPE_SZ);
+    if (capacity > 0 && len + 1 <= (size_t) capacity) {
+        if (write_all(pipe_fd[1], data, len) < 0 || write_all(pipe_fd[1], "\n", 1) < 0) {
+            perror("Failed to fill here-string pipe");
+            close(pipe_fd[0]);
+            close(pipe_fd[1]);
+            return -1;
         }
-
-        dup2(pipe_fd[0], STDIN_FILENO);
-        dup2(output_fd, STDOUT_FILENO);
         close(pipe_fd[1]);
-        close(pipe_fd[0]);
-        close(output_fd);
-
-        if (execve(sub_command_dest, sub_params_dest, NULL) == -1) {
-            perror("Failed to execute second command while handling pipe");
-            exit(EXIT_FAILURE);
-        }
+        return pipe_fd[0];
     }
-
     close(pipe_fd[0]);
     close(pipe_fd[1]);
 
-    wait(NULL);
-    wait(NULL);
-
-    return 0;
-}
-
-int handle_pipe2var(Node **head, const char* var_name, char *params[], const int num_tokens) {
-    char *sub_params[num_tokens - 1];
-    for(int i = 2; i < num_tokens; i++) {
-        sub_params[i - 2] = params[i];
+    // Anything larger would block the writer, so back it with an in-memory file instead
+    int fd = memfd_create("tsh-herestring", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Failed to create here-string memfd");
+        return -1;
     }
-    sub_params[num_tokens - 2] = NULL;
 
-    char *command_output;
-    handle_pipe(sub_params, &command_output);
-
-    update_variable(head, var_name, command_output);
-
-    free(command_output);
-    return 0;
+    if (write_all(fd, data, len) < 0 || write_all(fd, "\n", 1) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+        perror("Failed to fill here-string memfd");
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
 int read_line(const int infile, char *buffer, const int maxlen) {
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "parser.h"
+#include "expand.h"
+
+// Directory listings are read with getdents64 and kept sorted, keyed by the directory's mtime.
+// A listing is stat'ed at most once per line; on later lines it is reused until the mtime moves.
+
+#define DENTS_BUFFER 262144
+
+// A change within this many nanoseconds of reading a listing may not move the mtime,
+// so such listings are re-read instead of trusted (timestamps are only as fine as a clock tick)
+#define RACY_WINDOW_NS 50000000L
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct Listing {
+    char *path;
+    ino_t inode;
+    struct timespec mtime;
+    int racy;
+    unsigned long checked_line;
+    char **names;       // Sorted entry names, pointing into `arena`
+    int numnames;
+    char *arena;
+    struct Listing *next;
+} Listing;
+
+static Listing *cache = NULL;
+static unsigned long current_line = 1;
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static void free_listing(Listing *listing) {
+    free(listing->path);
+    free(listing->names);
+    free(listing->arena);
+    free(listing);
+}
+
+static int read_listing(Listing *listing) {
+    const int fd = open(listing->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    char *buffer = malloc(DENTS_BUFFER);
+    size_t arena_size = 4096, arena_used = 0;
+    char *arena = malloc(arena_size);
+    size_t *offsets = NULL;
+    int numnames = 0, capacity = 0;
+    if (buffer == NULL || arena == NULL) goto fail;
+
+    long bytes;
+    while ((bytes = syscall(SYS_getdents64, fd, buffer, DENTS_BUFFER)) > 0) {
+        for (long pos = 0; pos < bytes;) {
+            const struct linux_dirent64 *entry = (const struct linux_dirent64 *) (buffer + pos);
+            pos += entry->d_reclen;
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+            const size_t len = strlen(entry->d_name) + 1;
+            if (arena_used + len > arena_size) {
+                while (arena_used + len > arena_size) arena_size *= 2;
+                char *bigger = realloc(arena, arena_size);
+                if (bigger == NULL) goto fail;
+                arena = bigger;
+            }
+            if (numnames == capacity) {
+                capacity = capacity == 0 ? 256 : capacity * 2;
+                size_t *more = realloc(offsets, capacity * sizeof(size_t));
+                if (more == NULL) goto fail;
+                offsets = more;
+            }
+            memcpy(arena + arena_used, entry->d_name, len);
+            offsets[numnames++] = arena_used;
+            arena_used += len;
+        }
+    }
+    if (bytes < 0) goto fail;
+
+    // The arena no longer moves, so offsets can become pointers
+    char **names = malloc((numnames + 1) * sizeof(char *));
+    if (names == NULL) goto fail;
+    for (int i = 0; i < numnames; i++) names[i] = arena + offsets[i];
+    qsort(names, numnames, sizeof(char *), compare_names);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const long long age = (now.tv_sec - info.st_mtim.tv_sec) * 1000000000LL + (now.tv_nsec - info.st_mtim.tv_nsec);
+
+    free(listing->names);
+    free(listing->arena);
+    listing->names = names;
+    listing->numnames = numnames;
+    listing->arena = arena;
+    listing->inode = info.st_ino;
+    listing->mtime = info.st_mtim;
+    listing->racy = age < RACY_WINDOW_NS;
+
+    free(offsets);
+    free(buffer);
+    close(fd);
+    return 0;
+
+fail:
+    free(offsets);
+    free(arena);
+    free(buffer);
+    close(fd);
+    return -1;
+}
+
+static Listing *get_listing(const char *path) {
+    Listing **link = &cache;
+    while (*link != NULL && strcmp((*link)->path, path) != 0) link = &(*link)->next;
+
+    Listing *listing = *link;
+    if (listing != NULL) {
+        if (listing->checked_line == current_line) return listing;
+
+        struct stat info;
+        if (stat(path, &info) < 0) {
+            *link = listing->next;
+            free_listing(listing);
+            return NULL;
+        }
+        listing->checked_line = current_line;
+        if (!listing->racy && info.st_ino == listing->inode &&
+            info.st_mtim.tv_sec == listing->mtime.tv_sec && info.st_mtim.tv_nsec == listing->mtime.tv_nsec) {
+            return listing;
+        }
+        return read_listing(listing) == 0 ? listing : NULL;
+    }
+
+    listing = calloc(1, sizeof(Listing));
+    if (listing == NULL) return NULL;
+    listing->path = strdup(path);
+    if (listing->path == NULL || read_listing(listing) < 0) {
+        free_listing(listing);
+        return NULL;
+    }
+    listing->checked_line = current_line;
+    listing->next = cache;
+    cache = listing;
+    return listing;
+}
+
+static int add_match(char ***matches, int *nummatches, const char *path) {
+    char *copy = strdup(path);
+    char **more = copy == NULL ? NULL : realloc(*matches, (*nummatches + 1) * sizeof(char *));
+    if (more == NULL) {
+        free(copy);
+        return -1;
+    }
+    *matches = more;
+    (*matches)[(*nummatches)++] = copy;
+    return 0;
+}
+
+// Matches the components of `rest` one at a time below `base`, which is "" for relative patterns
+static void expand_from(const char *base, const char *rest, char ***matches, int *nummatches) {
+    const char *slash = strchr(rest, '/');
+    const size_t len = slash != NULL ? (size_t) (slash - rest) : strlen(rest);
+    const char *after = slash != NULL ? slash : rest + len;
+    while (*after == '/') after++;
+    const int last = *after == '\0';
+
+    char component[len + 1];
+    memcpy(component, rest, len);
+    component[len] = '\0';
+
+    // Keep the separators as written, so "dir//x" and a trailing "/" come back unchanged
+    const size_t separators = slash != NULL ? (size_t) (after - slash) : 0;
+    const size_t base_len = strlen(base);
+
+    if (strpbrk(component, "*?[") == NULL) {
+        char path[base_len + len + separators + 1];
+        snprintf(path, sizeof(path), "%s%s%.*s", base, component, (int) separators, slash != NULL ? slash : "");
+        if (!last) {
+            expand_from(path, after, matches, nummatches);
+        } else if (access(path, F_OK) == 0) {
+            add_match(matches, nummatches, path);
+        }
+        return;
+    }
+
+    Listing *listing = get_listing(base_len > 0 ? base : ".");
+    if (listing == NULL) return;
+
+    for (int i = 0; i < listing->numnames; i++) {
+        const char *name = listing->names[i];
+        if (fnmatch(component, name, FNM_PERIOD) != 0) continue;
+
+        char path[base_len + strlen(name) + separators + 1];
+        snprintf(path, sizeof(path), "%s%s%.*s", base, name, (int) separators, slash != NULL ? slash : "");
+        if (!last) {
+            expand_from(path, after, matches, nummatches);
+        } else if (slash == NULL) {
+            add_match(matches, nummatches, path);
+        } else {
+            // A trailing slash only matches directories
+            struct stat info;
+            if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) add_match(matches, nummatches, path);
+        }
+    }
+}
+
+int glob_expand(const char *pattern, char ***matches, int *nummatches) {
+    const int first = *nummatches;
+
+    const char *rest = pattern;
+    char base[2] = "";
+    if (*rest == '/') {
+        strcpy(base, "/");
+        while (*rest == '/') rest++;
+    }
+    if (*rest == '\0') return 0;
+
+    expand_from(base, rest, matches, nummatches);
+
+    // A single wildcard component comes out of one sorted listing; deeper patterns need a final sort
+    const char *wildcard = strpbrk(pattern, "*?[");
+    if (wildcard != NULL && strchr(wildcard, '/') != NULL) {
+        qsort(*matches + first, *nummatches - first, sizeof(char *), compare_names);
+    }
+    return *nummatches - first;
+}
+
+void glob_begin_line(void) {
+    current_line++;
+}
+
+void glob_cache_clear(void) {
+    while (cache != NULL) {
+        Listing *doomed = cache;
+        cache = cache->next;
+        free_listing(doomed);
+    }
+}
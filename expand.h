@@ -0,0 +1,11 @@
+#ifndef __EXPAND_H
+#define __EXPAND_H
+
+// Glob expansion of `*`, `?` and `[...]` against directory listings cached across lines
+int glob_expand(const char* pattern, char*** matches, int* nummatches);
+
+void glob_begin_line(void);
+
+void glob_cache_clear(void);
+
+#endif
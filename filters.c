@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "parser.h"
+#include "filters.h"
+#include "tuning.h"
+
+// Builtin versions of common filters. When a pipeline stage is one of these, the engine runs it
+// as a thread instead of forking a process. Only the plain stdin-to-stdout forms are handled here;
+// anything with file operands or unsupported options is left to the real program.
+
+#define FILTER_BUFFER 65536
+
+typedef struct {
+    stream_t* stream;
+    char* buffer;
+    size_t size;
+    size_t start;
+    size_t end;
+    int eof;
+} line_reader_t;
+
+typedef struct {
+    stream_t* stream;
+    size_t len;
+    char buffer[FILTER_BUFFER];
+} line_writer_t;
+
+static int parse_count(const char* text, long* count) {
+    if (text == NULL || *text == '\0') return FALSE;
+
+    char* end;
+    errno = 0;
+    *count = strtol(text, &end, 10);
+    return errno == 0 && *end == '\0' && isdigit((unsigned char) text[0]);
+}
+
+ssize_t stream_read(stream_t* stream, char* buffer, const size_t len) {
+    if (stream->ring != NULL) return ring_read(stream->ring, buffer, len);
+
+    ssize_t bytes;
+    do {
+        bytes = read(stream->fd, buffer, len);
+    } while (bytes < 0 && errno == EINTR);
+    return bytes;
+}
+
+int stream_write(stream_t* stream, const char* buffer, size_t len) {
+    while (len > 0) {
+        const ssize_t written = stream->ring != NULL ? ring_write(stream->ring, buffer, len)
+                                                     : write(stream->fd, buffer, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buffer += written;
+        len -= written;
+    }
+    return 0;
+}
+
+void stream_close_read(stream_t* stream) {
+    if (stream->ring != NULL) {
+        ring_close_read(stream->ring);
+    } else if (stream->owned) {
+        close(stream->fd);
+    }
+}
+
+void stream_close_write(stream_t* stream) {
+    if (stream->ring != NULL) {
+        ring_close_write(stream->ring);
+    } else if (stream->owned) {
+        close(stream->fd);
+    }
+}
+
+// Returns the length of the next line including its newline, 0 at end of input and -1 on error
+static ssize_t next_line(line_reader_t* reader, char** line) {
+    size_t scanned = reader->start;
+    while (1) {
+        char* newline = memchr(reader->buffer + scanned, '\n', reader->end - scanned);
+        if (newline != NULL || (reader->eof && reader->end > reader->start)) {
+            const size_t len = newline != NULL ? (size_t) (newline - reader->buffer) + 1 - reader->start
+                                               : reader->end - reader->start;
+            *line = reader->buffer + reader->start;
+            reader->start += len;
+            return len;
+        }
+        if (reader->eof) return 0;
+
+        // Keep the partial line at the front and make room for more input
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+        if (reader->end == reader->size) {
+            char* bigger = realloc(reader->buffer, reader->size * 2);
+            if (bigger == NULL) return -1;
+            reader->buffer = bigger;
+            reader->size *= 2;
+        }
+        scanned = reader->end;
+
+        const ssize_t bytes = stream_read(reader->stream, reader->buffer + reader->end, reader->size - reader->end);
+        if (bytes < 0) return -1;
+        if (bytes == 0) reader->eof = TRUE;
+        reader->end += bytes;
+    }
+}
+
+static int reader_init(line_reader_t* reader, stream_t* stream) {
+    memset(reader, 0, sizeof(line_reader_t));
+    reader->stream = stream;
+    reader->size = FILTER_BUFFER;
+    reader->buffer = malloc(reader->size);
+    return reader->buffer == NULL ? -1 : 0;
+}
+
+static int flush(line_writer_t* writer) {
+    const int status = stream_write(writer->stream, writer->buffer, writer->len);
+    writer->len = 0;
+    return status;
+}
+
+static int put(line_writer_t* writer, const char* data, const size_t len) {
+    if (writer->len + len > sizeof(writer->buffer)) {
+        if (flush(writer) < 0) return -1;
+        if (len > sizeof(writer->buffer)) return stream_write(writer->stream, data, len);
+    }
+    memcpy(writer->buffer + writer->len, data, len);
+    writer->len += len;
+    return 0;
+}
+
+static int run_rev(filter_t* filter, stream_t* in, stream_t* out) {
+    line_reader_t reader;
+    if (reader_init(&reader, in) < 0) return -1;
+    line_writer_t* writer = malloc(sizeof(line_writer_t));
+    if (writer == NULL) {
+        free(reader.buffer);
+        return -1;
+    }
+    writer->stream = out;
+    writer->len = 0;
+
+    int status = 0;
+    char* line;
+    ssize_t len;
+    while (status == 0 && (len = next_line(&reader, &line)) > 0) {
+        const int newline = line[len - 1] == '\n';
+        const size_t body = len - newline;
+        for (size_t i = 0; i < body / 2; i++) {
+            const char tmp = line[i];
+            line[i] = line[body - 1 - i];
+            line[body - 1 - i] = tmp;
+        }
+        status = put(writer, line, len);
+    }
+    status = status < 0 || len < 0 ? -1 : flush(writer);
+
+    free(writer);
+    free(reader.buffer);
+    return status;
+}
+
+static int run_head(filter_t* filter, stream_t* in, stream_t* out) {
+    line_reader_t reader;
+    if (reader_init(&reader, in) < 0) return -1;
+    line_writer_t* writer = malloc(sizeof(line_writer_t));
+    if (writer == NULL) {
+        free(reader.buffer);
+        return -1;
+    }
+    writer->stream = out;
+    writer->len = 0;
+
+    int status = 0;
+    char* line;
+    ssize_t len = 0;
+    for (long i = 0; status == 0 && i < filter->count && (len = next_line(&reader, &line)) > 0; i++) {
+        status = put(writer, line, len);
+    }
+    status = status < 0 || len < 0 ? -1 : flush(writer);
+
+    free(writer);
+    free(reader.buffer);
+    return status;
+}
+
+static int run_tail(filter_t* filter, stream_t* in, stream_t* out) {
+    line_reader_t reader;
+    if (reader_init(&reader, in) < 0) return -1;
+
+    // Keep the last `count` lines in a circular array that grows only as far as needed
+    char** lines = NULL;
+    size_t* lengths = NULL;
+    size_t capacity = 0;
+    size_t seen = 0;
+    const size_t count = filter->count;
+
+    int status = 0;
+    char* line;
+    ssize_t len = 0;
+    while (count > 0 && (len = next_line(&reader, &line)) > 0) {
+        if (seen < count && seen == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            capacity = capacity < count ? capacity : count;
+            char** more_lines = realloc(lines, capacity * sizeof(char*));
+            size_t* more_lengths = more_lines == NULL ? NULL : realloc(lengths, capacity * sizeof(size_t));
+            if (more_lines != NULL) lines = more_lines;
+            if (more_lengths == NULL) {
+                status = -1;
+                break;
+            }
+            lengths = more_lengths;
+        }
+
+        const size_t slot = seen % count;
+        char* copy = realloc(seen < count ? NULL : lines[slot], len);
+        if (copy == NULL) {
+            status = -1;
+            break;
+        }
+        memcpy(copy, line, len);
+        lines[slot] = copy;
+        lengths[slot] = len;
+        seen++;
+    }
+    if (len < 0) status = -1;
+
+    const size_t kept = seen < count ? seen : count;
+    const size_t first = seen <= count ? 0 : seen % count;
+    for (size_t i = 0; status == 0 && i < kept; i++) {
+        const size_t slot = (first + i) % count;
+        status = stream_write(out, lines[slot], lengths[slot]);
+    }
+
+    for (size_t i = 0; i < kept; i++) free(lines[i]);
+    free(lines);
+    free(lengths);
+    free(reader.buffer);
+    return status;
+}
+
+static int run_wc(filter_t* filter, stream_t* in, stream_t* out) {
+    char* buffer = malloc(FILTER_BUFFER);
+    if (buffer == NULL) return -1;
+
+    long lines = 0, words = 0, bytes = 0;
+    int in_word = FALSE;
+    ssize_t len;
+    while ((len = stream_read(in, buffer, FILTER_BUFFER)) > 0) {
+        bytes += len;
+        if (filter->flags & WC_LINES) {
+            for (char* p = buffer; (p = memchr(p, '\n', buffer + len - p)) != NULL; p++) lines++;
+        }
+        if (filter->flags & WC_WORDS) {
+            for (ssize_t i = 0; i < len; i++) {
+                const int space = isspace((unsigned char) buffer[i]);
+                if (!space && !in_word) words++;
+                in_word = !space;
+            }
+        }
+    }
+    free(buffer);
+    if (len < 0) return -1;
+
+    // Like wc reading stdin: a single counter is printed bare, several are padded to 7 columns
+    const long counts[] = {lines, words, bytes};
+    const int masks[] = {WC_LINES, WC_WORDS, WC_BYTES};
+    const int single = filter->flags == WC_LINES || filter->flags == WC_WORDS || filter->flags == WC_BYTES;
+    char result[128];
+    int used = 0;
+    for (int i = 0; i < 3; i++) {
+        if (!(filter->flags & masks[i])) continue;
+        used += snprintf(result + used, sizeof(result) - used, "%s%*ld", used > 0 ? " " : "", single ? 1 : 7, counts[i]);
+    }
+    used += snprintf(result + used, sizeof(result) - used, "\n");
+
+    return stream_write(out, result, used);
+}
+
+static int run_grep(filter_t* filter, stream_t* in, stream_t* out) {
+    line_reader_t reader;
+    if (reader_init(&reader, in) < 0) return -1;
+    line_writer_t* writer = malloc(sizeof(line_writer_t));
+    if (writer == NULL) {
+        free(reader.buffer);
+        return -1;
+    }
+    writer->stream = out;
+    writer->len = 0;
+
+    const size_t pattern_len = strlen(filter->pattern);
+    int status = 0;
+    char* line;
+    ssize_t len;
+    while (status == 0 && (len = next_line(&reader, &line)) > 0) {
+        const int newline = line[len - 1] == '\n';
+        const int match = memmem(line, len - newline, filter->pattern, pattern_len) != NULL;
+        if (match != filter->flags) {
+            // grep always terminates the lines it prints
+            status = put(writer, line, len - newline);
+            if (status == 0) status = put(writer, "\n", 1);
+        }
+    }
+    status = status < 0 || len < 0 ? -1 : flush(writer);
+
+    free(writer);
+    free(reader.buffer);
+    return status;
+}
+
+int filter_parse(char* argv[], filter_t* filter) {
+    memset(filter, 0, sizeof(filter_t));
+    const char* name = argv[0];
+    if (name == NULL || strchr(name, '/') != NULL) return FALSE;
+
+    if (strcmp(name, "rev") == 0) {
+        filter->run = run_rev;
+        return argv[1] == NULL;
+    }
+
+    if (strcmp(name, "head") == 0 || strcmp(name, "tail") == 0) {
+        filter->run = name[0] == 'h' ? run_head : run_tail;
+        filter->count = 10;
+        if (argv[1] == NULL) return TRUE;
+        if (strcmp(argv[1], "-n") == 0) return argv[2] != NULL && argv[3] == NULL && parse_count(argv[2], &filter->count);
+        if (strncmp(argv[1], "-n", 2) == 0) return argv[2] == NULL && parse_count(argv[1] + 2, &filter->count);
+        return argv[1][0] == '-' && argv[2] == NULL && parse_count(argv[1] + 1, &filter->count);
+    }
+
+    if (strcmp(name, "wc") == 0) {
+        filter->run = run_wc;
+        for (int i = 1; argv[i] != NULL; i++) {
+            if (argv[i][0] != '-' || argv[i][1] == '\0') return FALSE;
+            for (const char* flag = argv[i] + 1; *flag != '\0'; flag++) {
+                if (*flag == 'l') filter->flags |= WC_LINES;
+                else if (*flag == 'w') filter->flags |= WC_WORDS;
+                else if (*flag == 'c') filter->flags |= WC_BYTES;
+                else return FALSE;
+            }
+        }
+        if (filter->flags == 0) filter->flags = WC_LINES | WC_WORDS | WC_BYTES;
+        return TRUE;
+    }
+
+    if (strcmp(name, "grep") == 0) {
+        filter->run = run_grep;
+        int fixed = FALSE;
+        int i = 1;
+        for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+            for (const char* flag = argv[i] + 1; *flag != '\0'; flag++) {
+                if (*flag == 'v') filter->flags = TRUE;
+                else if (*flag == 'F') fixed = TRUE;
+                else return FALSE;
+            }
+        }
+        // Exactly one pattern and no files; without -F it must not use any regex syntax
+        if (argv[i] == NULL || argv[i + 1] != NULL) return FALSE;
+        filter->pattern = argv[i];
+        return fixed || strpbrk(filter->pattern, ".[]*^$\\") == NULL;
+    }
+
+    return FALSE;
+}
+
+void* filter_thread(void* arg) {
+    filter_stage_t* stage = arg;
+
+    // A closed downstream pipe must end this stage, not the whole engine
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    tuning_pin(stage->cpu);
+
+    // errno is per thread, so keep it for the engine to report after the join
+    stage->status = stage->filter.run(&stage->filter, &stage->in, &stage->out) < 0 ? (errno != 0 ? errno : EIO) : 0;
+
+    stream_close_read(&stage->in);
+    stream_close_write(&stage->out);
+    return NULL;
+}
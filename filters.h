@@ -0,0 +1,46 @@
+#ifndef __FILTERS_H
+#define __FILTERS_H
+
+#include <sys/types.h>
+#include "ring.h"
+
+#define WC_LINES 1
+#define WC_WORDS 2
+#define WC_BYTES 4
+
+// One end of a pipeline stage: either a file descriptor or an in-process ring
+typedef struct {
+    int fd;         // -1 when the stream is backed by a ring
+    int owned;      // Close fd once the stage is done with it
+    ring_t* ring;
+} stream_t;
+
+typedef struct filter {
+    int (*run)(struct filter* filter, stream_t* in, stream_t* out);
+    long count;             // head/tail: number of lines
+    int flags;              // wc: WC_* counters, grep: invert match
+    const char* pattern;    // grep: fixed string to look for
+} filter_t;
+
+// A builtin filter running as a thread inside the engine
+typedef struct {
+    filter_t filter;
+    stream_t in;
+    stream_t out;
+    int cpu;                // CPU to pin the thread to, -1 to leave it unpinned
+    int status;             // 0, or the errno value the filter failed with
+} filter_stage_t;
+
+int filter_parse(char* argv[], filter_t* filter);
+
+void* filter_thread(void* arg);
+
+ssize_t stream_read(stream_t* stream, char* buffer, size_t len);
+
+int stream_write(stream_t* stream, const char* buffer, size_t len);
+
+void stream_close_read(stream_t* stream);
+
+void stream_close_write(stream_t* stream);
+
+#endif
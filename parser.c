@@ -23,21 +23,25 @@ token_t** tokenize(const char* inputbuffer, size_t bufferlen, int* numtokens) {
                 tokens[*numtokens] = malloc(sizeof(token_t));
                 if (inputbuffer[start_string] == '$') {
                     tokens[*numtokens]->type = TOKEN_VAR;
-                    tokens[*numtokens]->value = malloc(end_string-start_string);
+                    tokens[*numtokens]->value = malloc(end_string-start_string+1);
                     strncpy(tokens[*numtokens]->value, inputbuffer+start_string+1, end_string-start_string);
                     tokens[*numtokens]->value[end_string-start_string] = 0;
                 } else {
                     if ( terminator == '"' ) {
                         tokens[*numtokens]->type = TOKEN_STRING;
-                        tokens[*numtokens]->value = malloc(end_string-start_string);
+                        tokens[*numtokens]->value = malloc(end_string-start_string+1);
                         strncpy(tokens[*numtokens]->value, inputbuffer+start_string+1, end_string-start_string+1);
                         tokens[*numtokens]->value[end_string-start_string] = 0;
                     }
                     else {
                         tokens[*numtokens]->type = TOKEN_STRING;
-                        tokens[*numtokens]->value = malloc(end_string-start_string+1);
+                        tokens[*numtokens]->value = malloc(end_string-start_string+2);
                         strncpy(tokens[*numtokens]->value, inputbuffer+start_string, end_string-start_string+1);
                         tokens[*numtokens]->value[end_string-start_string+1] = 0;
+                        // Unquoted words with wildcards are expanded by the engine
+                        if ( strpbrk(tokens[*numtokens]->value, "*?[") != NULL ) {
+                            tokens[*numtokens]->type = TOKEN_GLOB;
+                        }
                     }
                 }
                 (*numtokens)++;
@@ -66,6 +70,14 @@ token_t** tokenize(const char* inputbuffer, size_t bufferlen, int* numtokens) {
                 tokens[*numtokens]->type = TOKEN_REDIR;
                 tokens[*numtokens]->value = NULL;
                 (*numtokens)++;
+            } else if ( strncmp(inputbuffer+bufpos, "<<<", 3) == 0 ) {
+                // Here-string: the next word is fed to the command's stdin
+                tokens = realloc(tokens, (*numtokens+1)*sizeof(token_t*));
+                tokens[*numtokens] = malloc(sizeof(token_t));
+                tokens[*numtokens]->type = TOKEN_HERESTR;
+                tokens[*numtokens]->value = NULL;
+                (*numtokens)++;
+                bufpos += 2;
             } else {
                 in_string = TRUE;
                 start_string = bufpos;
@@ -85,14 +97,17 @@ token_t** tokenize(const char* inputbuffer, size_t bufferlen, int* numtokens) {
         tokens[*numtokens] = malloc(sizeof(token_t));
         if (inputbuffer[start_string] == '$') {
             tokens[*numtokens]->type = TOKEN_VAR;
-            tokens[*numtokens]->value = malloc(end_string-start_string);
+            tokens[*numtokens]->value = malloc(end_string-start_string+1);
             strncpy(tokens[*numtokens]->value, inputbuffer+start_string+1, end_string-start_string);
             tokens[*numtokens]->value[end_string-start_string] = 0;
         } else {
             tokens[*numtokens]->type = TOKEN_STRING;
-            tokens[*numtokens]->value = malloc(end_string-start_string+1);
+            tokens[*numtokens]->value = malloc(end_string-start_string+2);
             strncpy(tokens[*numtokens]->value, inputbuffer+start_string, end_string-start_string+1);
             tokens[*numtokens]->value[end_string-start_string+1] = 0;
+            if ( terminator != '"' && strpbrk(tokens[*numtokens]->value, "*?[") != NULL ) {
+                tokens[*numtokens]->type = TOKEN_GLOB;
+            }
         }
         (*numtokens)++;
         in_string = FALSE;
@@ -13,6 +13,8 @@ typedef enum {
     TOKEN_VAR,
     TOKEN_PIPE,
     TOKEN_REDIR,
+    TOKEN_HERESTR,
+    TOKEN_GLOB,
 } token_type_t;
 
 typedef struct {
@@ -23,7 +25,7 @@ typedef struct {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-variable"
 static const char *TOKEN_TO_STRING[] = {
-    "TOKEN STRING", "TOKEN ASSIGN", "TOKEN VAR", "TOKEN PIPE", "TOKEN REDIR",
+    "TOKEN STRING", "TOKEN ASSIGN", "TOKEN VAR", "TOKEN PIPE", "TOKEN REDIR", "TOKEN HERESTR", "TOKEN GLOB",
 };
 #pragma GCC diagnostic pop
 
@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "ring.h"
+
+// How many times a side re-checks the ring before going to sleep
+#define RING_SPIN 64
+
+static void futex_wait(_Atomic uint32_t *addr, uint32_t expected) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *addr) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+ring_t* ring_create(size_t capacity) {
+    uint32_t size = 4096;
+    while (size < capacity && size < (1u << 30)) size <<= 1;
+
+    ring_t* ring = aligned_alloc(64, sizeof(ring_t));
+    if (ring == NULL) return NULL;
+    memset(ring, 0, sizeof(ring_t));
+
+    ring->data = malloc(size);
+    if (ring->data == NULL) {
+        free(ring);
+        return NULL;
+    }
+    ring->capacity = size;
+    return ring;
+}
+
+void ring_destroy(ring_t* ring) {
+    if (ring == NULL) return;
+    free(ring->data);
+    free(ring);
+}
+
+ssize_t ring_write(ring_t* ring, const char* buffer, size_t len) {
+    int spins = 0;
+    while (1) {
+        if (atomic_load(&ring->reader_closed)) {
+            errno = EPIPE;
+            return -1;
+        }
+
+        const uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        const uint32_t tail = atomic_load(&ring->tail);
+        const uint32_t space = ring->capacity - (head - tail);
+        if (space > 0) {
+            const uint32_t n = len < space ? len : space;
+            const uint32_t offset = head & (ring->capacity - 1);
+            const uint32_t first = n < ring->capacity - offset ? n : ring->capacity - offset;
+            memcpy(ring->data + offset, buffer, first);
+            memcpy(ring->data, buffer + first, n - first);
+            atomic_store(&ring->head, head + n);
+
+            if (atomic_load(&ring->reader_waiting)) {
+                atomic_fetch_add(&ring->read_seq, 1);
+                futex_wake(&ring->read_seq);
+            }
+            return n;
+        }
+
+        if (spins++ < RING_SPIN) continue;
+
+        // Publish that we are about to sleep before the final check, so a reader cannot miss us
+        atomic_store(&ring->writer_waiting, 1);
+        const uint32_t seq = atomic_load(&ring->write_seq);
+        if (atomic_load(&ring->tail) == tail && !atomic_load(&ring->reader_closed)) {
+            futex_wait(&ring->write_seq, seq);
+        }
+        atomic_store(&ring->writer_waiting, 0);
+    }
+}
+
+ssize_t ring_read(ring_t* ring, char* buffer, size_t len) {
+    int spins = 0;
+    while (1) {
+        const uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        const uint32_t head = atomic_load(&ring->head);
+        if (head != tail) {
+            const uint32_t available = head - tail;
+            const uint32_t n = len < available ? len : available;
+            const uint32_t offset = tail & (ring->capacity - 1);
+            const uint32_t first = n < ring->capacity - offset ? n : ring->capacity - offset;
+            memcpy(buffer, ring->data + offset, first);
+            memcpy(buffer + first, ring->data, n - first);
+            atomic_store(&ring->tail, tail + n);
+
+            if (atomic_load(&ring->writer_waiting)) {
+                atomic_fetch_add(&ring->write_seq, 1);
+                futex_wake(&ring->write_seq);
+            }
+            return n;
+        }
+
+        // The producer closes only after its last write, so an empty ring here is final
+        if (atomic_load(&ring->writer_closed)) {
+            if (atomic_load(&ring->head) == tail) return 0;
+            continue;
+        }
+
+        if (spins++ < RING_SPIN) continue;
+
+        atomic_store(&ring->reader_waiting, 1);
+        const uint32_t seq = atomic_load(&ring->read_seq);
+        if (atomic_load(&ring->head) == head && !atomic_load(&ring->writer_closed)) {
+            futex_wait(&ring->read_seq, seq);
+        }
+        atomic_store(&ring->reader_waiting, 0);
+    }
+}
+
+void ring_close_write(ring_t* ring) {
+    atomic_store(&ring->writer_closed, 1);
+    atomic_fetch_add(&ring->read_seq, 1);
+    futex_wake(&ring->read_seq);
+}
+
+void ring_close_read(ring_t* ring) {
+    atomic_store(&ring->reader_closed, 1);
+    atomic_fetch_add(&ring->write_seq, 1);
+    futex_wake(&ring->write_seq);
+}
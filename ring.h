@@ -0,0 +1,37 @@
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Single-producer/single-consumer byte ring used to join two in-process pipeline stages.
+// Data moves without locks; a blocked side sleeps on a futex until the other side makes progress.
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head;     // Total bytes written, only advanced by the producer
+    _Atomic uint32_t read_seq;              // Bumped to wake a consumer waiting for data
+    _Atomic int reader_waiting;
+    _Atomic int writer_closed;
+
+    _Alignas(64) _Atomic uint32_t tail;     // Total bytes read, only advanced by the consumer
+    _Atomic uint32_t write_seq;             // Bumped to wake a producer waiting for space
+    _Atomic int writer_waiting;
+    _Atomic int reader_closed;
+
+    _Alignas(64) char *data;
+    uint32_t capacity;                      // Always a power of two
+} ring_t;
+
+ring_t* ring_create(size_t capacity);
+
+void ring_destroy(ring_t* ring);
+
+ssize_t ring_write(ring_t* ring, const char* buffer, size_t len);
+
+ssize_t ring_read(ring_t* ring, char* buffer, size_t len);
+
+void ring_close_write(ring_t* ring);
+
+void ring_close_read(ring_t* ring);
+
+#endif
@@ -20,3 +20,19 @@ os.system("python3 test_feature4.py")
 os.chdir("../test_feature5")
 # run the test_feature5.py script
 os.system("python3 test_feature5.py")
+# move back into the test_feature6 directory
+os.chdir("../test_feature6")
+# run the test_feature6.py script
+os.system("python3 test_feature6.py")
+# move back into the test_feature7 directory
+os.chdir("../test_feature7")
+# run the test_feature7.py script
+os.system("python3 test_feature7.py")
+# move back into the test_feature8 directory
+os.chdir("../test_feature8")
+# run the test_feature8.py script
+os.system("python3 test_feature8.py")
+# move back into the test_feature9 directory
+os.chdir("../test_feature9")
+# run the test_feature9.py script
+os.system("python3 test_feature9.py")
@@ -0,0 +1,22 @@
+#!/usr/bin/python3
+
+import sys
+import os
+
+def run_test(test_name, input_file, output_file):
+    sys.stdout.write("Running test " + test_name + "... ")
+    os.system("../engine.out " + input_file + "> temp.txt")
+    if os.system("diff temp.txt " + output_file + " > /dev/null") != 0:
+        print("\033[91mFAILED\033[0m")
+        sys.exit(1)
+    else:
+        print("\033[92mPASSED\033[0m")
+
+tests = [("Test 6.1: basic here-string", "test6.1.in", "test6.1.out"),
+         ("Test 6.2: here-string from a variable + redirection", "test6.2.in", "test6.2.out"),
+         ("Test 6.3: here-string with pipes and assignment", "test6.3.in", "test6.3.out"),
+         ("Test 6.4: here-string larger than a pipe", "test6.4.in", "test6.4.out")]
+
+for test in tests:
+    run_test(*test)
+os.system("rm -f temp.txt")
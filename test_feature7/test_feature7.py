@@ -0,0 +1,24 @@
+#!/usr/bin/python3
+
+import sys
+import os
+
+def run_test(test_name, input_file, output_file):
+    sys.stdout.write("Running test " + test_name + "... ")
+    os.system("../engine.out " + input_file + "> temp.txt")
+    if os.system("diff temp.txt " + output_file + " > /dev/null") != 0:
+        print("\033[91mFAILED\033[0m")
+        sys.exit(1)
+    else:
+        print("\033[92mPASSED\033[0m")
+
+tests = [("Test 7.1: chained builtin filters", "test7.1.in", "test7.1.out"),
+         ("Test 7.2: builtin filters mixed with processes", "test7.2.in", "test7.2.out"),
+         ("Test 7.3: builtin filters into a variable", "test7.3.in", "test7.3.out"),
+         ("Test 7.4: builtin head ending a pipeline early", "test7.4.in", "test7.4.out"),
+         ("Test 7.5: incomplete pipeline into a variable", "test7.5.in", "test7.5.out"),
+         ("Test 7.6: multi-stage pipelines + redirection", "test7.6.in", "test7.6.out")]
+
+for test in tests:
+    run_test(*test)
+os.system("rm -f temp.txt")
@@ -0,0 +1,23 @@
+#!/usr/bin/python3
+
+import sys
+import os
+
+def run_test(test_name, input_file, output_file):
+    sys.stdout.write("Running test " + test_name + "... ")
+    os.system("../engine.out " + input_file + "> temp.txt")
+    if os.system("diff temp.txt " + output_file + " > /dev/null") != 0:
+        print("\033[91mFAILED\033[0m")
+        sys.exit(1)
+    else:
+        print("\033[92mPASSED\033[0m")
+
+tests = [("Test 8.1: basic glob", "test8.1.in", "test8.1.out"),
+         ("Test 8.2: glob patterns with ? and [...]", "test8.2.in", "test8.2.out"),
+         ("Test 8.3: quoted and unmatched globs", "test8.3.in", "test8.3.out"),
+         ("Test 8.4: glob after the directory changes", "test8.4.in", "test8.4.out"),
+         ("Test 8.5: glob as a redirect target", "test8.5.in", "test8.5.out")]
+
+for test in tests:
+    run_test(*test)
+os.system("rm -f temp.txt")
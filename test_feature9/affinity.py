@@ -0,0 +1,25 @@
+#!/usr/bin/python3
+
+# Pipeline stage for test 9.2: prints the CPUs this process may run on, or with "threads",
+# the CPUs of the engine's builtin stage threads (the engine is this process's parent).
+
+import os
+import sys
+import time
+
+if len(sys.argv) > 1 and sys.argv[1] == "threads":
+    engine = os.getppid()
+    threads = []
+    for _ in range(200):
+        threads = [int(task) for task in os.listdir("/proc/%d/task" % engine) if int(task) != engine]
+        if threads:
+            break
+        time.sleep(0.01)
+    # Give the builtin thread time to pin itself after it starts
+    time.sleep(0.1)
+    cpus = set()
+    for thread in threads:
+        cpus |= os.sched_getaffinity(thread)
+    print("thread affinity", sorted(cpus))
+else:
+    print("process affinity", sorted(os.sched_getaffinity(0)))
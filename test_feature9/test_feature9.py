@@ -0,0 +1,46 @@
+#!/usr/bin/python3
+
+import sys
+import os
+
+def run_test(test_name, input_file, output_file):
+    sys.stdout.write("Running test " + test_name + "... ")
+    os.system("../engine.out " + input_file + "> temp.txt")
+    if os.system("diff temp.txt " + output_file + " > /dev/null") != 0:
+        print("\033[91mFAILED\033[0m")
+        sys.exit(1)
+    else:
+        print("\033[92mPASSED\033[0m")
+
+def write_pinning_test(input_file, output_file):
+    # The CPUs depend on the machine, so test 9.2 is generated from the ones we may use.
+    # Stage 0 (a process) goes to the first listed CPU and stage 1 (a builtin thread) to the second.
+    allowed = sorted(os.sched_getaffinity(0))
+    first, second = allowed[-1], allowed[0]
+    with open(input_file, "w") as script:
+        script.write("python3 affinity.py | rev | rev\n")
+        script.write("python3 affinity.py threads | grep affinity\n")
+        script.write("TSH_CPUS = echo -n %d,%d\n" % (first, second))
+        script.write("python3 affinity.py | rev | rev\n")
+        script.write("python3 affinity.py threads | grep affinity\n")
+    with open(output_file, "w") as expected:
+        expected.write("process affinity %s\n" % allowed)
+        expected.write("thread affinity %s\n" % allowed)
+        expected.write("process affinity %s\n" % [first])
+        expected.write("thread affinity %s\n" % [second])
+
+tests = [("Test 9.1: pipe capacity per pipeline", "test9.1.in", "test9.1.out"),
+         ("Test 9.2: pinning pipeline stages to CPUs", "test9.2.in", "test9.2.out"),
+         ("Test 9.3: invalid tuning values are ignored", "test9.3.in", "test9.3.out"),
+         ("Test 9.4: empty pipe capacity restores the default", "test9.4.in", "test9.4.out"),
+         ("Test 9.5: assigning more output than a small pipe holds", "test9.5.in", "test9.5.out")]
+
+if len(os.sched_getaffinity(0)) > 1:
+    write_pinning_test("test9.2.in", "test9.2.out")
+else:
+    print("Skipping test 9.2: pinning pipeline stages to CPUs (only one CPU available)")
+    tests.pop(1)
+
+for test in tests:
+    run_test(*test)
+os.system("rm -f temp.txt test9.2.in test9.2.out")
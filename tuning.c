@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "parser.h"
+#include "tuning.h"
+
+#define DEFAULT_RING_CAPACITY 65536
+
+typedef struct {
+    int pipe_size;              // Bytes requested with F_SETPIPE_SZ, 0 keeps the kernel default
+    int cpus[CPU_SETSIZE];      // Stage i runs on cpus[i % numcpus]
+    int numcpus;
+} settings_t;
+
+static settings_t defaults;
+static settings_t current;
+
+// The variable values the current settings were parsed from, so unchanged lines skip the parsing
+static char *last_pipe_size = NULL;
+static char *last_cpus = NULL;
+static int warned_pipe_size = FALSE;
+
+static int parse_size(const char *text, int *size) {
+    char *end;
+    const long value = strtol(text, &end, 10);
+    if (end == text || value < 0) return -1;
+
+    long scale = 1;
+    if (*end == 'k' || *end == 'K') scale = 1024;
+    if (*end == 'm' || *end == 'M') scale = 1024 * 1024;
+    if (scale > 1) end++;
+    if (*end != '\0' || value > 0x7fffffff / scale) return -1;
+
+    *size = value * scale;
+    return 0;
+}
+
+// Appends the CPUs of a list such as "0,2-5" to `cpus` in the order they are written
+static int parse_list(const char *text, int *cpus, int *numcpus) {
+    while (*text != '\0') {
+        char *end;
+        const long first = strtol(text, &end, 10);
+        if (end == text || !isdigit((unsigned char) *text)) return -1;
+        long last = first;
+        if (*end == '-') {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text || !isdigit((unsigned char) *text)) return -1;
+        }
+        if (first > last || last >= CPU_SETSIZE) return -1;
+
+        for (long cpu = first; cpu <= last && *numcpus < CPU_SETSIZE; cpu++) cpus[(*numcpus)++] = cpu;
+
+        if (*end == ',') end++;
+        else if (*end != '\0' && *end != '\n') return -1;
+        else if (*end == '\n') break;
+        text = end;
+    }
+    return 0;
+}
+
+// Orders the allowed CPUs so that hyperthread siblings come next to each other
+static void sibling_order(const cpu_set_t *allowed, int *cpus, int *numcpus) {
+    cpu_set_t placed;
+    CPU_ZERO(&placed);
+    *numcpus = 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, allowed) || CPU_ISSET(cpu, &placed)) continue;
+
+        int siblings[CPU_SETSIZE];
+        int numsiblings = 0;
+        char path[128], list[256];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        FILE *file = fopen(path, "r");
+        if (file == NULL || fgets(list, sizeof(list), file) == NULL || parse_list(list, siblings, &numsiblings) < 0) {
+            siblings[0] = cpu;
+            numsiblings = 1;
+        }
+        if (file != NULL) fclose(file);
+
+        for (int i = 0; i < numsiblings; i++) {
+            if (!CPU_ISSET(siblings[i], allowed) || CPU_ISSET(siblings[i], &placed)) continue;
+            CPU_SET(siblings[i], &placed);
+            cpus[(*numcpus)++] = siblings[i];
+        }
+    }
+}
+
+static int parse_cpus(const char *text, int *cpus, int *numcpus) {
+    *numcpus = 0;
+    if (*text == '\0') return 0;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("Failed to read the engine's CPU affinity");
+        return -1;
+    }
+
+    if (strcmp(text, "siblings") == 0) {
+        sibling_order(&allowed, cpus, numcpus);
+        return 0;
+    }
+
+    if (parse_list(text, cpus, numcpus) < 0) return -1;
+    for (int i = 0; i < *numcpus; i++) {
+        if (!CPU_ISSET(cpus[i], &allowed)) return -1;
+    }
+    return 0;
+}
+
+static int same_value(const char *a, const char *b) {
+    return (a == NULL && b == NULL) || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+int tuning_configure(const char *pipe_size, const char *cpus) {
+    if (pipe_size != NULL && parse_size(pipe_size, &defaults.pipe_size) < 0) {
+        fprintf(stderr, "Invalid pipe size: %s\n", pipe_size);
+        return -1;
+    }
+    if (cpus != NULL && parse_cpus(cpus, defaults.cpus, &defaults.numcpus) < 0) {
+        fprintf(stderr, "Invalid or unavailable CPU list: %s\n", cpus);
+        return -1;
+    }
+    current = defaults;
+    return 0;
+}
+
+void tuning_begin_line(const char *pipe_size, const char *cpus) {
+    if (!same_value(pipe_size, last_pipe_size)) {
+        current.pipe_size = defaults.pipe_size;
+        if (pipe_size != NULL && *pipe_size != '\0' && parse_size(pipe_size, &current.pipe_size) < 0) {
+            fprintf(stderr, "Ignoring invalid TSH_PIPESIZE: %s\n", pipe_size);
+            current.pipe_size = defaults.pipe_size;
+        }
+        free(last_pipe_size);
+        last_pipe_size = pipe_size != NULL ? strdup(pipe_size) : NULL;
+        warned_pipe_size = FALSE;
+    }
+
+    if (!same_value(cpus, last_cpus)) {
+        memcpy(current.cpus, defaults.cpus, sizeof(current.cpus));
+        current.numcpus = defaults.numcpus;
+        if (cpus != NULL && *cpus != '\0' && parse_cpus(cpus, current.cpus, &current.numcpus) < 0) {
+            fprintf(stderr, "Ignoring invalid or unavailable TSH_CPUS: %s\n", cpus);
+            memcpy(current.cpus, defaults.cpus, sizeof(current.cpus));
+            current.numcpus = defaults.numcpus;
+        }
+        free(last_cpus);
+        last_cpus = cpus != NULL ? strdup(cpus) : NULL;
+    }
+}
+
+void tuning_clear(void) {
+    free(last_pipe_size);
+    free(last_cpus);
+    last_pipe_size = NULL;
+    last_cpus = NULL;
+}
+
+int tuned_pipe(int pipefd[2]) {
+    if (pipe2(pipefd, O_CLOEXEC) == -1) return -1;
+
+    // The kernel caps unprivileged sizes at /proc/sys/fs/pipe-max-size; keep the default then
+    if (current.pipe_size > 0 && fcntl(pipefd[1], F_SETPIPE_SZ, current.pipe_size) < 0 && !warned_pipe_size) {
+        perror("Failed to set pipe size");
+        warned_pipe_size = TRUE;
+    }
+    return 0;
+}
+
+size_t tuning_ring_capacity(void) {
+    return current.pipe_size > 0 ? (size_t) current.pipe_size : DEFAULT_RING_CAPACITY;
+}
+
+int tuning_stage_cpu(const int stage) {
+    return current.numcpus > 0 ? current.cpus[stage % current.numcpus] : -1;
+}
+
+void tuning_pin(const int cpu) {
+    if (cpu < 0) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
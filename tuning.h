@@ -0,0 +1,24 @@
+#ifndef __TUNING_H
+#define __TUNING_H
+
+#include <stddef.h>
+
+// Pipe capacity and CPU placement for pipeline stages.
+// Script-wide defaults come from the engine's command line; the TSH_PIPESIZE and TSH_CPUS
+// variables override them for every pipeline that runs while they are set to a non-empty value.
+
+int tuning_configure(const char* pipe_size, const char* cpus);
+
+void tuning_begin_line(const char* pipe_size, const char* cpus);
+
+void tuning_clear(void);
+
+int tuned_pipe(int pipefd[2]);
+
+size_t tuning_ring_capacity(void);
+
+int tuning_stage_cpu(int stage);
+
+void tuning_pin(int cpu);
+
+#endif